@@ -0,0 +1,228 @@
+// include/ring_tracer.h
+// Low-overhead event tracing: every thread writes fixed-size binary records into its own
+// lock-free ring buffer, and a background thread flushes the rings to a file. Decode the file
+// with the trace-decode example (learn/tracing/trace-decode.cpp).
+//
+// LEARN_TRACE(event, object, value) compiles to nothing unless LEARN_TRACE_ENABLED is defined
+// (cmake -DLEARN_TRACE=ON). The output file is $LEARN_TRACE_FILE, or learn-trace.bin.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace trace {
+
+// event ids; the names match the text the examples used to print
+enum class Event : std::uint32_t {
+  default_ctor,
+  int_ctor,
+  copy_ctor,
+  move_ctor,
+  copy_assign,
+  move_assign,
+  dtor,
+  vector_move_ctor,
+  vector_move_assign,
+  dropped,  // written by the flusher: value = events lost because a ring was full
+  user,     // first id free for ad-hoc use
+};
+
+inline const char* event_name(Event e) {
+  switch (e) {
+    case Event::default_ctor: return "default constructor";
+    case Event::int_ctor: return "constructor with int argument";
+    case Event::copy_ctor: return "copy constructor";
+    case Event::move_ctor: return "move constructor";
+    case Event::copy_assign: return "copy assignment operator";
+    case Event::move_assign: return "move assignment operator";
+    case Event::dtor: return "destructor";
+    case Event::vector_move_ctor: return "Vector move constructor";
+    case Event::vector_move_assign: return "Vector move assignment operator";
+    case Event::dropped: return "dropped events";
+    default: return "user event";
+  }
+}
+
+// the X events (default_ctor .. dtor) store the object's current value and the new one in the
+// 64-bit value field, 32 bits each; the other events store a single value
+inline bool has_value_pair(Event e) { return e <= Event::dtor; }
+
+inline std::int64_t pack_values(std::int32_t current, std::int32_t next) {
+  return std::int64_t(std::uint64_t(std::uint32_t(current)) << 32 | std::uint32_t(next));
+}
+
+inline std::int32_t current_value(std::int64_t packed) {
+  return std::int32_t(std::uint32_t(std::uint64_t(packed) >> 32));
+}
+
+inline std::int32_t next_value(std::int64_t packed) { return std::int32_t(std::uint32_t(packed)); }
+
+// one event as it is stored in memory and in the file: 32 bytes, no padding
+struct Record {
+  std::uint64_t ts_ns;   // steady_clock time
+  std::uint32_t id;      // Event
+  std::uint32_t thread;  // small per-process thread number
+  std::uint64_t object;  // address of the object the event is about
+  std::int64_t value;
+};
+static_assert(sizeof(Record) == 32);
+
+// file layout: File_header followed by Records until the end of the file
+struct File_header {
+  char magic[4] = {'L', 'T', 'R', 'C'};
+  std::uint32_t version = 2;  // 2: X's events carry two values, see pack_values
+  std::uint32_t record_size = sizeof(Record);
+  std::uint32_t reserved = 0;
+};
+
+// single-producer (the owning thread) / single-consumer (the flusher) ring of Records
+class Ring {
+ public:
+  static constexpr std::uint64_t capacity = 1 << 14;  // power of two: index with a mask
+
+  explicit Ring(std::uint32_t t) : thread{t} {}
+
+  // never blocks: if the flusher has fallen behind, the event is counted and dropped
+  void push(Event e, const void* obj, std::int64_t value) {
+    std::uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == capacity) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Record& r = buf[h & (capacity - 1)];
+    r.ts_ns = now_ns();
+    r.id = static_cast<std::uint32_t>(e);
+    r.thread = thread;
+    r.object = reinterpret_cast<std::uintptr_t>(obj);
+    r.value = value;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  // write everything published so far to f; called by the flusher only
+  void drain(std::FILE* f) {
+    std::uint64_t h = head.load(std::memory_order_acquire);
+    std::uint64_t t = tail.load(std::memory_order_relaxed);
+    while (t != h) {
+      // up to the end of the buffer, then wrap around: at most two writes
+      std::uint64_t i = t & (capacity - 1);
+      std::uint64_t n = std::min(h - t, capacity - i);
+      std::fwrite(&buf[i], sizeof(Record), n, f);
+      t += n;
+    }
+    tail.store(t, std::memory_order_release);
+
+    if (std::uint64_t d = dropped.exchange(0, std::memory_order_relaxed)) {
+      Record r{now_ns(), static_cast<std::uint32_t>(Event::dropped), thread, 0,
+               static_cast<std::int64_t>(d)};
+      std::fwrite(&r, sizeof r, 1, f);
+    }
+  }
+
+  static std::uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  // producer and consumer indices on separate cache lines so they do not false-share
+  alignas(64) std::atomic<std::uint64_t> head{0};
+  alignas(64) std::atomic<std::uint64_t> tail{0};
+  std::atomic<std::uint64_t> dropped{0};
+  std::uint32_t thread;
+  Record buf[capacity];
+};
+
+// owns the rings and the flusher thread; started on the first event
+class Tracer {
+ public:
+  static Tracer& get() {
+    static Tracer t;
+    return t;
+  }
+
+  // the calling thread's ring, created and registered on first use
+  Ring& local_ring() {
+    thread_local Ring* r = nullptr;
+    if (!r) r = add_ring();
+    return *r;
+  }
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  // stop the flusher and write whatever is left
+  ~Tracer() {
+    {
+      std::lock_guard lock{m};
+      stopping = true;
+    }
+    wake.notify_one();
+    if (flusher.joinable()) flusher.join();
+    if (file) {
+      flush_all();
+      std::fclose(file);
+    }
+  }
+
+ private:
+  Tracer() {
+    const char* path = std::getenv("LEARN_TRACE_FILE");
+    file = std::fopen(path ? path : "learn-trace.bin", "wb");
+    if (!file) return;  // tracing silently off: events still go to the rings
+    File_header h;
+    std::fwrite(&h, sizeof h, 1, file);
+    flusher = std::thread{[this] { run(); }};
+  }
+
+  Ring* add_ring() {
+    std::lock_guard lock{m};
+    rings.push_back(std::make_unique<Ring>(static_cast<std::uint32_t>(rings.size())));
+    return rings.back().get();
+  }
+
+  void flush_all() {
+    std::lock_guard lock{m};
+    for (auto& r : rings) r->drain(file);
+    std::fflush(file);
+  }
+
+  void run() {
+    std::unique_lock lock{m};
+    while (!stopping) {
+      wake.wait_for(lock, std::chrono::milliseconds{10});
+      lock.unlock();
+      flush_all();
+      lock.lock();
+    }
+  }
+
+  std::mutex m;  // guards rings and stopping, not the hot path
+  std::condition_variable wake;
+  bool stopping = false;
+  std::vector<std::unique_ptr<Ring>> rings;  // kept until exit: threads may outlive their events
+  std::FILE* file = nullptr;
+  std::thread flusher;
+};
+
+inline void emit(Event e, const void* obj, std::int64_t value) {
+  Tracer::get().local_ring().push(e, obj, value);
+}
+
+}  // namespace trace
+
+#if defined(LEARN_TRACE_ENABLED)
+#define LEARN_TRACE(event, object, value) ::trace::emit((event), (object), (value))
+#else
+#define LEARN_TRACE(event, object, value) ((void)0)
+#endif
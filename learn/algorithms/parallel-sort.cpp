@@ -0,0 +1,330 @@
+/*
+
+Parallel radix sort and sample sort for Vector<T, A>
+
+std::sort(v.begin(), v.end()) is a comparison sort on one thread: O(n log n) comparisons, many of
+them mispredicted branches.
+
+LSD radix sort: no comparisons at all. Each key is turned into an unsigned integer whose order is
+the same as the key's order, then the elements are distributed by 8 bits at a time, least
+significant byte first (4 passes for int, 8 for double). Each pass is a stable counting sort:
+
+  1. every thread counts the byte values in its chunk (a histogram)
+  2. prefix sums over (byte value, thread) give every thread its own output positions
+  3. every thread scatters its chunk into the scratch buffer
+
+Passes in which every key has the same byte are skipped.
+
+Sample sort: works with any comparator. Pick p - 1 splitters from a sorted random sample, put
+every element into the bucket between two splitters (same count/prefix/scatter scheme), then
+std::sort the p buckets on p threads.
+
+Both use one scratch buffer of n elements, allocated through the vector's own allocator. Sample
+sort also keeps the bucket number of every element there (the allocator rebound to
+std::uint16_t); only its small per-thread tables (sample, splitters, counts) are std::vectors.
+
+*/
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+template <typename T>
+struct Allocator {
+  Allocator() = default;
+
+  // rebinding: an Allocator<int> can make the Allocator<std::uint16_t> for a side array
+  template <typename U>
+  Allocator(const Allocator<U>&) {}
+
+  T* allocate(int n) {
+    if (n <= 0) return nullptr;
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, int n) { ::operator delete(p, n * sizeof(T)); }
+};
+
+// A<T> -> A<U>, like std::allocator_traits<A>::rebind_alloc<U>
+template <typename A, typename U>
+struct Rebind;
+
+template <template <typename> class Alloc, typename T, typename U>
+struct Rebind<Alloc<T>, U> {
+  using type = Alloc<U>;
+};
+
+template <typename A, typename U>
+using Rebind_t = typename Rebind<A, U>::type;
+
+template <typename T, typename A>
+struct Vector_rep {
+  A alloc;
+  int sz;
+  T* elem;
+  int space;
+
+  Vector_rep(const A& a, int n) : alloc{a}, sz{0}, elem{alloc.allocate(n)}, space{n} {}
+
+  Vector_rep(const Vector_rep&) = delete;
+  Vector_rep& operator=(const Vector_rep&) = delete;
+
+  ~Vector_rep() { alloc.deallocate(elem, space); }
+
+  void swap_storage(Vector_rep& other) noexcept {
+    std::swap(sz, other.sz);
+    std::swap(elem, other.elem);
+    std::swap(space, other.space);
+  }
+};
+
+template <typename T, typename A = Allocator<T>>
+class Vector {
+  Vector_rep<T, A> r;
+
+ public:
+  Vector() : r{A{}, 0} {}
+
+  explicit Vector(int s) : r{A{}, s} {
+    std::uninitialized_fill(r.elem, r.elem + s, T{});
+    r.sz = s;
+  }
+
+  Vector(const Vector& v) : r{v.r.alloc, v.size()} {
+    std::uninitialized_copy(v.begin(), v.end(), r.elem);
+    r.sz = v.size();
+  }
+
+  Vector& operator=(const Vector&) = delete;
+
+  ~Vector() { std::destroy(r.elem, r.elem + r.sz); }
+
+  T& operator[](int n) { return r.elem[n]; }
+  const T& operator[](int n) const { return r.elem[n]; }
+
+  int size() const { return r.sz; }
+  A get_allocator() const { return r.alloc; }
+
+  T* begin() const { return r.elem; }
+  T* end() const { return r.elem + r.sz; }
+};
+
+// run f(0) ... f(n_threads - 1), one per thread; the calling thread runs f(0)
+template <typename F>
+void parallel_for(int n_threads, F f) {
+  std::vector<std::thread> threads;
+  for (int t = 1; t < n_threads; ++t) threads.emplace_back(f, t);
+  f(0);
+  for (auto& th : threads) th.join();
+}
+
+// [begin, end) of chunk t when n elements are split into p nearly equal chunks
+inline std::pair<int, int> chunk(int n, int p, int t) {
+  return {int(std::int64_t(n) * t / p), int(std::int64_t(n) * (t + 1) / p)};
+}
+
+// order-preserving unsigned keys
+inline std::uint32_t radix_key(int x) { return std::bit_cast<std::uint32_t>(x) ^ 0x80000000u; }
+
+// positive doubles: set the sign bit so they come after the negatives;
+// negative doubles: flip all bits so that larger magnitudes come first. NaNs sort to the ends.
+inline std::uint64_t radix_key(double x) {
+  std::uint64_t b = std::bit_cast<std::uint64_t>(x);
+  return (b & 0x8000000000000000ull) ? ~b : b | 0x8000000000000000ull;
+}
+
+template <typename T, typename A>
+  requires std::is_same_v<T, int> || std::is_same_v<T, double>
+void radix_sort(Vector<T, A>& v, int n_threads = int(std::thread::hardware_concurrency())) {
+  using Key = decltype(radix_key(T{}));
+  const int n = v.size();
+  if (n < 2) return;
+  n_threads = std::clamp(n_threads, 1, std::max(1, n / 65536));  // small inputs: one thread
+
+  Vector_rep<T, A> scratch{v.get_allocator(), n};
+  T* src = v.begin();
+  T* dst = scratch.elem;
+
+  // count[t][b]: how many keys of thread t's chunk have byte value b in this pass
+  std::vector<std::array<int, 256>> count(n_threads);
+
+  for (int shift = 0; shift < int(sizeof(Key) * 8); shift += 8) {
+    parallel_for(n_threads, [&](int t) {
+      auto [b, e] = chunk(n, n_threads, t);
+      auto& c = count[t];
+      c.fill(0);
+      for (int i = b; i < e; ++i) ++c[(radix_key(src[i]) >> shift) & 0xff];
+    });
+
+    // all keys have the same byte here: this pass would not move anything
+    bool trivial = false;
+    for (int d = 0; d < 256 && !trivial; ++d) {
+      int total = 0;
+      for (int t = 0; t < n_threads; ++t) total += count[t][d];
+      trivial = total == n;
+    }
+    if (trivial) continue;
+
+    // exclusive prefix sum in (byte, thread) order turns counts into start positions
+    int pos = 0;
+    for (int d = 0; d < 256; ++d) {
+      for (int t = 0; t < n_threads; ++t) {
+        int c = count[t][d];
+        count[t][d] = pos;
+        pos += c;
+      }
+    }
+
+    parallel_for(n_threads, [&](int t) {
+      auto [b, e] = chunk(n, n_threads, t);
+      auto& p = count[t];
+      for (int i = b; i < e; ++i) dst[p[(radix_key(src[i]) >> shift) & 0xff]++] = src[i];
+    });
+    std::swap(src, dst);
+  }
+
+  // ints and doubles are trivially copyable: the scratch buffer needs no construct/destroy
+  if (src != v.begin()) std::memcpy(v.begin(), src, n * sizeof(T));
+}
+
+template <typename T, typename A, typename Cmp = std::less<>>
+void sample_sort(Vector<T, A>& v, Cmp cmp = {},
+                 int n_threads = int(std::thread::hardware_concurrency())) {
+  const int n = v.size();
+  n_threads = std::clamp(n_threads, 1, std::max(1, n / 65536));
+  if (n_threads == 1) {
+    std::sort(v.begin(), v.end(), cmp);
+    return;
+  }
+  const int p = n_threads;  // one bucket per thread
+
+  // sorted random sample, oversampled so the buckets come out about the same size
+  const int oversample = 64;
+  std::mt19937 gen{12345};
+  std::uniform_int_distribution<int> pick{0, n - 1};
+  std::vector<T> sample;
+  for (int i = 0; i < p * oversample; ++i) sample.push_back(v[pick(gen)]);
+  std::sort(sample.begin(), sample.end(), cmp);
+  std::vector<T> splitters;
+  for (int i = 1; i < p; ++i) splitters.push_back(sample[i * oversample]);
+
+  // bucket of every element: number of splitters not greater than it
+  using Bucket_alloc = Rebind_t<A, std::uint16_t>;
+  Vector_rep<std::uint16_t, Bucket_alloc> bucket{Bucket_alloc{v.get_allocator()}, n};
+  std::vector<std::vector<int>> count(p, std::vector<int>(p));
+  parallel_for(p, [&](int t) {
+    auto [b, e] = chunk(n, p, t);
+    for (int i = b; i < e; ++i) {
+      int k = int(std::upper_bound(splitters.begin(), splitters.end(), v[i], cmp) -
+                  splitters.begin());
+      bucket.elem[i] = std::uint16_t(k);
+      ++count[t][k];
+    }
+  });
+
+  std::vector<int> bucket_begin(p + 1);
+  int pos = 0;
+  for (int k = 0; k < p; ++k) {
+    bucket_begin[k] = pos;
+    for (int t = 0; t < p; ++t) {
+      int c = count[t][k];
+      count[t][k] = pos;
+      pos += c;
+    }
+  }
+  bucket_begin[p] = n;
+
+  // move everything into the scratch buffer grouped by bucket, sort each bucket there,
+  // and move it back
+  Vector_rep<T, A> scratch{v.get_allocator(), n};
+  parallel_for(p, [&](int t) {
+    auto [b, e] = chunk(n, p, t);
+    for (int i = b; i < e; ++i)
+      std::construct_at(&scratch.elem[count[t][bucket.elem[i]]++], std::move(v[i]));
+  });
+  parallel_for(p, [&](int k) {
+    T* b = scratch.elem + bucket_begin[k];
+    T* e = scratch.elem + bucket_begin[k + 1];
+    std::sort(b, e, cmp);
+    std::move(b, e, v.begin() + bucket_begin[k]);
+    std::destroy(b, e);
+  });
+}
+
+using Clock = std::chrono::steady_clock;
+
+template <typename V, typename F>
+double ms(V data, F sort, bool& ok) {
+  auto t0 = Clock::now();
+  sort(data);
+  double t = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+  ok = ok && std::is_sorted(data.begin(), data.end());
+  return t;
+}
+
+template <typename T>
+void bench(const char* name, const Vector<T>& data, int max_threads) {
+  bool ok = true;
+  double t_std = ms(data, [](auto& v) { std::sort(v.begin(), v.end()); }, ok);
+  std::cout << "  " << name << ": std::sort " << t_std << " ms";
+  for (int t = 1; t <= max_threads; t *= 2) {
+    double t_radix = ms(data, [t](auto& v) { radix_sort(v, t); }, ok);
+    double t_sample = ms(data, [t](auto& v) { sample_sort(v, std::less<>{}, t); }, ok);
+    std::cout << " | " << t << " thr: radix " << t_radix << ", sample " << t_sample;
+  }
+  std::cout << (ok ? "" : "  NOT SORTED") << "\n";
+}
+
+int main(int argc, char* argv[]) {
+  std::cout << "Parallel radix sort and sample sort\n";
+
+  Vector<double> small(8);
+  double vals[] = {3.5, -0.0, -2.25, 1e300, -1e-300, 0.0, -7.0, 42.0};
+  std::copy(std::begin(vals), std::end(vals), small.begin());
+  radix_sort(small);
+  for (double d : small) std::cout << " " << d;
+  std::cout << "\n";
+
+  int max_n = argc > 1 ? std::atoi(argv[1]) : 1'000'000;
+  int max_threads = argc > 2 ? std::atoi(argv[2]) : 4;
+  std::mt19937 gen{1};
+
+  for (int n = 100'000; n <= max_n; n *= 10) {
+    std::cout << n << " elements\n";
+    Vector<int> uniform(n), few(n), sorted(n);
+    Vector<double> normal(n);
+    std::uniform_int_distribution<int> any;
+    std::normal_distribution<double> gauss{0.0, 1e3};
+    for (int i = 0; i < n; ++i) {
+      uniform[i] = any(gen);
+      few[i] = any(gen) % 16;
+      sorted[i] = i;
+      normal[i] = gauss(gen);
+    }
+    bench("int uniform  ", uniform, max_threads);
+    bench("int 16 values", few, max_threads);
+    bench("int sorted   ", sorted, max_threads);
+    bench("double normal", normal, max_threads);
+  }
+
+  /*
+  Observation (one run on a single core, so threads cannot help here): on random ints radix sort
+  is 4-5x faster than std::sort; with 16 distinct values three of the four passes are skipped.
+  Already sorted input is std::sort's best case and radix sort's normal case, so std::sort wins
+  there. Doubles need 8 passes and gain less. Sample sort on one core is std::sort plus the cost
+  of distributing into buckets; it pays off only with one core per bucket.
+  */
+
+  return 0;
+}
@@ -0,0 +1,517 @@
+/*
+
+Polymorphic memory resources
+
+Allocator<T> is a template parameter of Vector<T, A>, so Vector<int, Allocator<int>> and
+Vector<int, Arena_allocator<int>> are different types: a function taking one cannot take the other.
+
+The pmr idea moves the choice of allocator from compile time to run time:
+
+- Memory_resource is an abstract base class with virtual do_allocate / do_deallocate.
+- Polymorphic_allocator<T> only holds a Memory_resource* and forwards to it. It has the same
+  allocate(n) / deallocate(p, n) interface as Allocator<T>, so it can be used as the A of a Vector.
+- Every Vector<T, Polymorphic_allocator<T>> is the same type, whatever resource is behind it.
+
+The price is one virtual call per allocation (not per element access).
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// abstract interface for "somewhere memory comes from"
+class Memory_resource {
+ public:
+  virtual ~Memory_resource() = default;
+
+  void* allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t)) {
+    return do_allocate(bytes, align);
+  }
+
+  void deallocate(void* p, std::size_t bytes, std::size_t align = alignof(std::max_align_t)) {
+    do_deallocate(p, bytes, align);
+  }
+
+  // two resources are equal if memory allocated from one can be freed through the other
+  bool is_equal(const Memory_resource& other) const noexcept { return do_is_equal(other); }
+
+ private:
+  virtual void* do_allocate(std::size_t bytes, std::size_t align) = 0;
+  virtual void do_deallocate(void* p, std::size_t bytes, std::size_t align) = 0;
+  virtual bool do_is_equal(const Memory_resource& other) const noexcept { return this == &other; }
+};
+
+// forwards to the global operator new/delete: the default upstream of every other resource.
+// The aligned forms are only needed above what plain new already guarantees.
+class New_delete_resource : public Memory_resource {
+  void* do_allocate(std::size_t bytes, std::size_t align) override {
+    if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) return ::operator new(bytes);
+    return ::operator new(bytes, std::align_val_t{align});
+  }
+
+  void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+    if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) return ::operator delete(p, bytes);
+    ::operator delete(p, bytes, std::align_val_t{align});
+  }
+};
+
+Memory_resource* new_delete_resource() {
+  static New_delete_resource res;
+  return &res;
+}
+
+// hands out memory by bumping a pointer through big chunks; deallocate does nothing and
+// everything is given back at once when the resource is destroyed (or release() is called)
+class Monotonic_buffer_resource : public Memory_resource {
+  struct Chunk {
+    Chunk* next;
+    std::size_t size;  // bytes including this header
+  };
+
+  Memory_resource* upstream;
+  Chunk* chunks = nullptr;
+  char* cur = nullptr;  // next free byte in the current chunk
+  std::size_t left = 0;  // bytes left in the current chunk
+  std::size_t next_size;  // size of the next chunk: grows geometrically
+
+ public:
+  explicit Monotonic_buffer_resource(std::size_t initial = 1024,
+                                     Memory_resource* up = new_delete_resource())
+      : upstream{up}, next_size{std::max<std::size_t>(initial, sizeof(Chunk) * 2)} {}
+
+  Monotonic_buffer_resource(const Monotonic_buffer_resource&) = delete;
+  Monotonic_buffer_resource& operator=(const Monotonic_buffer_resource&) = delete;
+
+  ~Monotonic_buffer_resource() override { release(); }
+
+  void release() {
+    while (chunks) {
+      Chunk* next = chunks->next;
+      upstream->deallocate(chunks, chunks->size);
+      chunks = next;
+    }
+    cur = nullptr;
+    left = 0;
+  }
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t align) override {
+    void* p = cur;
+    if (!p || !std::align(align, bytes, p, left)) {
+      new_chunk(bytes + align);
+      p = cur;
+      std::align(align, bytes, p, left);  // cannot fail: the chunk is big enough
+    }
+    cur = static_cast<char*>(p) + bytes;
+    left -= bytes;
+    return p;
+  }
+
+  void do_deallocate(void*, std::size_t, std::size_t) override {}  // freed all at once
+
+  void new_chunk(std::size_t min_bytes) {
+    std::size_t size = std::max(next_size, min_bytes + sizeof(Chunk));
+    auto* c = static_cast<Chunk*>(upstream->allocate(size));
+    c->next = chunks;
+    c->size = size;
+    chunks = c;
+    cur = reinterpret_cast<char*>(c + 1);
+    left = size - sizeof(Chunk);
+    next_size = size * 2;
+  }
+};
+
+// keeps a free list for each power-of-two block size; freed blocks are reused for the next
+// request of the same size class. Not thread safe.
+class Unsynchronized_pool_resource : public Memory_resource {
+  static constexpr std::size_t min_block = 8;
+  static constexpr std::size_t max_block = 4096;  // larger requests go straight upstream
+  static constexpr int n_classes = 10;            // 8, 16, ..., 4096
+  static constexpr std::size_t chunk_bytes = 64 * 1024;
+
+  struct Free_block {
+    Free_block* next;
+  };
+
+  struct Chunk {
+    Chunk* next;
+    std::size_t size;
+    std::size_t align;
+  };
+
+  Memory_resource* upstream;
+  Free_block* free_lists[n_classes] = {};
+  Chunk* chunks = nullptr;
+
+ public:
+  explicit Unsynchronized_pool_resource(Memory_resource* up = new_delete_resource())
+      : upstream{up} {}
+
+  Unsynchronized_pool_resource(const Unsynchronized_pool_resource&) = delete;
+  Unsynchronized_pool_resource& operator=(const Unsynchronized_pool_resource&) = delete;
+
+  ~Unsynchronized_pool_resource() override { release(); }
+
+  void release() {
+    while (chunks) {
+      Chunk* next = chunks->next;
+      upstream->deallocate(chunks, chunks->size, chunks->align);
+      chunks = next;
+    }
+    std::fill(std::begin(free_lists), std::end(free_lists), nullptr);
+  }
+
+ private:
+  // index of the smallest class that holds bytes, or -1 if too big for the pool
+  static int size_class(std::size_t bytes, std::size_t align) {
+    std::size_t block = std::max({bytes, align, min_block});
+    if (block > max_block) return -1;
+    int c = 0;
+    for (std::size_t s = min_block; s < block; s *= 2) ++c;
+    return c;
+  }
+
+  void* do_allocate(std::size_t bytes, std::size_t align) override {
+    int c = size_class(bytes, align);
+    if (c < 0) return upstream->allocate(bytes, align);
+    if (!free_lists[c]) refill(c);
+    Free_block* b = free_lists[c];
+    free_lists[c] = b->next;
+    return b;
+  }
+
+  void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+    int c = size_class(bytes, align);
+    if (c < 0) {
+      upstream->deallocate(p, bytes, align);
+      return;
+    }
+    auto* b = static_cast<Free_block*>(p);
+    b->next = free_lists[c];
+    free_lists[c] = b;
+  }
+
+  // carve a new chunk into blocks of class c and put them all on its free list
+  void refill(int c) {
+    std::size_t block = min_block << c;
+    // round the header up to a whole block so every block stays aligned to its size
+    std::size_t header = (sizeof(Chunk) + block - 1) / block * block;
+    std::size_t n = std::max<std::size_t>(chunk_bytes / block, 1);
+    std::size_t size = header + n * block;
+    std::size_t align = std::max(block, alignof(std::max_align_t));
+    auto* ch = static_cast<Chunk*>(upstream->allocate(size, align));
+    ch->next = chunks;
+    ch->size = size;
+    ch->align = align;
+    chunks = ch;
+
+    char* first = reinterpret_cast<char*>(ch) + header;
+    for (std::size_t i = 0; i < n; ++i) {
+      auto* b = reinterpret_cast<Free_block*>(first + i * block);
+      b->next = free_lists[c];
+      free_lists[c] = b;
+    }
+  }
+};
+
+// the same pool with a lock around it, for sharing one pool between threads
+class Synchronized_pool_resource : public Memory_resource {
+  std::mutex m;
+  Unsynchronized_pool_resource pool;
+
+ public:
+  explicit Synchronized_pool_resource(Memory_resource* up = new_delete_resource()) : pool{up} {}
+
+  void release() {
+    std::lock_guard lock{m};
+    pool.release();
+  }
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t align) override {
+    std::lock_guard lock{m};
+    return pool.allocate(bytes, align);
+  }
+
+  void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+    std::lock_guard lock{m};
+    pool.deallocate(p, bytes, align);
+  }
+};
+
+// the allocator the Vector sees: same interface as Allocator<T>, but the work is done by
+// whatever resource it points to
+template <typename T>
+class Polymorphic_allocator {
+  Memory_resource* res;
+
+ public:
+  // assigning a container never changes the resource it allocates from
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::false_type;
+
+  Polymorphic_allocator() : res{new_delete_resource()} {}
+  Polymorphic_allocator(Memory_resource* r) : res{r} {}  // implicit, like std::pmr
+
+  template <typename U>
+  Polymorphic_allocator(const Polymorphic_allocator<U>& other) : res{other.resource()} {}
+
+  T* allocate(int n) {
+    if (n <= 0) return nullptr;
+    return static_cast<T*>(res->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, int n) {
+    if (p) res->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  // a copy-constructed container allocates from the same resource as its source
+  Polymorphic_allocator select_on_container_copy_construction() const { return *this; }
+
+  Memory_resource* resource() const { return res; }
+
+  friend bool operator==(const Polymorphic_allocator& a, const Polymorphic_allocator& b) {
+    return a.res == b.res || a.res->is_equal(*b.res);
+  }
+};
+
+// the static allocator from templates-exceptions/vector_template.cpp, for comparison
+template <typename T>
+struct Allocator {
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+
+  T* allocate(int n) {
+    if (n <= 0) return nullptr;
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, int) { ::operator delete(p); }
+
+  Allocator select_on_container_copy_construction() const { return *this; }
+
+  friend bool operator==(const Allocator&, const Allocator&) { return true; }
+};
+
+// RAII owner of the raw memory; the allocator lives here so deallocate uses the right one
+template <typename T, typename A>
+struct Vector_rep {
+  A alloc;
+  int sz;
+  T* elem;
+  int space;
+
+  Vector_rep(const A& a, int n) : alloc{a}, sz{0}, elem{alloc.allocate(n)}, space{n} {}
+
+  Vector_rep(const Vector_rep&) = delete;
+  Vector_rep& operator=(const Vector_rep&) = delete;
+
+  ~Vector_rep() { alloc.deallocate(elem, space); }
+
+  // swap the buffers only; the allocators must be equal for this to be valid
+  void swap_storage(Vector_rep& other) noexcept {
+    std::swap(sz, other.sz);
+    std::swap(elem, other.elem);
+    std::swap(space, other.space);
+  }
+};
+
+template <typename T, typename A = Allocator<T>>
+class Vector {
+  Vector_rep<T, A> r;
+
+ public:
+  explicit Vector(const A& a = A{}) : r{a, 0} {}
+
+  // copy: the allocator decides which resource the copy uses
+  Vector(const Vector& v) : r{v.r.alloc.select_on_container_copy_construction(), v.size()} {
+    std::uninitialized_copy(v.begin(), v.end(), r.elem);
+    r.sz = v.size();
+  }
+
+  // move: steal the buffer, and the allocator (resource) that owns it
+  Vector(Vector&& v) noexcept : r{v.r.alloc, 0} { r.swap_storage(v.r); }
+
+  // copy assignment keeps our own resource, elements are copied into it
+  Vector& operator=(const Vector& v) {
+    if (this == &v) return *this;
+    Vector tmp(v, r.alloc);
+    r.swap_storage(tmp.r);
+    return *this;
+  }
+
+  // move assignment can only steal the buffer if both sides allocate from the same place;
+  // otherwise the elements are moved one by one into our own resource
+  Vector& operator=(Vector&& v) {
+    if (this == &v) return *this;
+    if constexpr (A::propagate_on_container_move_assignment::value) {
+      clear();
+      r.swap_storage(v.r);
+      std::swap(r.alloc, v.r.alloc);
+    } else if (r.alloc == v.r.alloc) {
+      clear();
+      r.swap_storage(v.r);
+    } else {
+      Vector tmp(r.alloc);
+      tmp.reserve(v.size());
+      std::uninitialized_move(v.begin(), v.end(), tmp.r.elem);
+      tmp.r.sz = v.size();
+      r.swap_storage(tmp.r);
+    }
+    return *this;
+  }
+
+  // copy into a given allocator
+  Vector(const Vector& v, const A& a) : r{a, v.size()} {
+    std::uninitialized_copy(v.begin(), v.end(), r.elem);
+    r.sz = v.size();
+  }
+
+  ~Vector() { clear(); }
+
+  T& operator[](int n) { return r.elem[n]; }
+  const T& operator[](int n) const { return r.elem[n]; }
+
+  int size() const { return r.sz; }
+  int capacity() const { return r.space; }
+  A get_allocator() const { return r.alloc; }
+
+  void reserve(int newalloc);
+  void push_back(const T& val);
+
+  void clear() {
+    std::destroy(r.elem, r.elem + r.sz);
+    r.sz = 0;
+  }
+
+  T* begin() const { return r.elem; }
+  T* end() const { return r.elem + r.sz; }
+};
+
+template <typename T, typename A>
+void Vector<T, A>::reserve(int newalloc) {
+  if (newalloc <= r.space) return;
+
+  Vector_rep<T, A> b{r.alloc, newalloc};
+  std::uninitialized_move(r.elem, r.elem + r.sz, b.elem);
+  std::destroy(r.elem, r.elem + r.sz);
+  b.sz = r.sz;
+  r.swap_storage(b);  // b now owns the old buffer and frees it
+}
+
+template <typename T, typename A>
+void Vector<T, A>::push_back(const T& val) {
+  if (r.sz == r.space) reserve(r.space == 0 ? 8 : 2 * r.space);
+  std::construct_at(&r.elem[r.sz], val);
+  ++r.sz;
+}
+
+using Pmr_vector = Vector<int, Polymorphic_allocator<int>>;
+
+// one function for every resource: this is the point of the pmr design
+long long sum(const Pmr_vector& v) {
+  long long s = 0;
+  for (int x : v) s += x;
+  return s;
+}
+
+// build `rounds` vectors of n ints each; returns nanoseconds per push_back
+template <typename A>
+double time_push_back(const A& alloc, int rounds, int n, long long& check) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int k = 0; k < rounds; ++k) {
+    Vector<int, A> v(alloc);
+    for (int i = 0; i < n; ++i) v.push_back(i);
+    check += v[n - 1];
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / (double(rounds) * n);
+}
+
+int main() {
+  std::cout << "Polymorphic memory resources\n";
+
+  Monotonic_buffer_resource arena{4096};
+  Unsynchronized_pool_resource pool;
+
+  Pmr_vector a{&arena};
+  Pmr_vector b{&pool};
+  for (int i = 0; i < 10; ++i) {
+    a.push_back(i);
+    b.push_back(i * i);
+  }
+
+  // same type, different resources: sum() takes both
+  std::cout << "sum(a) = " << sum(a) << ", sum(b) = " << sum(b) << "\n";
+
+  /*
+  Expect:
+  - copy construction keeps the source's resource
+  - move construction steals the buffer and the resource
+  - copy/move assignment keep the target's resource
+  */
+  Pmr_vector c = a;
+  std::cout << "copy of a uses the arena: " << (c.get_allocator().resource() == &arena) << "\n";
+
+  Pmr_vector d = std::move(b);
+  std::cout << "moved-from b's buffer now in d, d uses the pool: "
+            << (d.get_allocator().resource() == &pool) << ", b.size() = " << b.size() << "\n";
+
+  c = std::move(d);  // different resources: element-wise move into the arena
+  std::cout << "after c = move(d), c still uses the arena: "
+            << (c.get_allocator().resource() == &arena) << ", c[3] = " << c[3] << "\n";
+
+  // cost of the virtual call: many small vectors, so allocation is a large part of the work
+  std::cout << "\nBenchmark: ns per push_back (1e5 vectors of 64 ints)\n";
+  const int rounds = 100000;
+  const int n = 64;
+  long long check = 0;
+
+  double t_static = time_push_back(Allocator<int>{}, rounds, n, check);
+  double t_newdel = time_push_back(Polymorphic_allocator<int>{}, rounds, n, check);
+
+  Unsynchronized_pool_resource bench_pool;
+  double t_pool = time_push_back(Polymorphic_allocator<int>{&bench_pool}, rounds, n, check);
+
+  Synchronized_pool_resource bench_sync_pool;
+  double t_sync = time_push_back(Polymorphic_allocator<int>{&bench_sync_pool}, rounds, n, check);
+
+  double t_mono = 0;
+  {
+    // monotonic never reuses memory, so give each batch its own arena
+    auto t0 = std::chrono::steady_clock::now();
+    for (int k = 0; k < rounds / 1000; ++k) {
+      Monotonic_buffer_resource batch{64 * 1024};
+      time_push_back(Polymorphic_allocator<int>{&batch}, 1000, n, check);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    t_mono = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double(rounds) * n);
+  }
+
+  std::cout << "  Allocator<int> (static)        " << t_static << "\n";
+  std::cout << "  polymorphic, new/delete        " << t_newdel << "\n";
+  std::cout << "  polymorphic, unsynchronized    " << t_pool << "\n";
+  std::cout << "  polymorphic, synchronized pool " << t_sync << "\n";
+  std::cout << "  polymorphic, monotonic         " << t_mono << "\n";
+  std::cout << "(check " << check << ")\n";
+
+  /*
+  Observation (three runs, 1 core): static 1.9-2.1, polymorphic new/delete 2.1-2.15,
+  unsynchronized pool 1.9-2.0, synchronized pool 2.35-2.45, monotonic 3.3-3.8 ns per push_back.
+
+  With both sides calling the same plain operator new, the virtual call costs a few percent at
+  most (it happens once per allocation, not per element). The unsynchronized pool is level with
+  the static allocator because it avoids the heap, and the mutex of the synchronized pool costs
+  more than the heap call it saves. Monotonic never reuses the buffers abandoned by reserve(),
+  so it touches much more fresh memory.
+  */
+
+  return 0;
+}
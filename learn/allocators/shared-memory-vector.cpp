@@ -0,0 +1,630 @@
+/*
+
+Sharing one Vector between processes
+
+Processes that each load the same read-mostly data keep a private copy each, so memory grows with
+the number of processes. A named POSIX shared-memory object (shm_open + mmap) lets one process
+build the data once while every other process maps the same physical pages.
+
+Two things stop an ordinary Vector<T, A> from living in such a segment:
+
+1. T* elem is an absolute address, and every process maps the segment at its own address, so a
+   pointer stored by the builder means nothing to a reader. Offset_ptr<T> stores the distance
+   from itself to the target instead, which is the same in every mapping.
+2. Allocator<T> gets memory from operator new, i.e. the builder's private heap. Shm_allocator<T>
+   bumps a cursor through the segment instead (monotonic, like Monotonic_buffer_resource in
+   pmr-allocator.cpp) and declares "using pointer = Offset_ptr<T>".
+
+Vector_rep takes its pointer type from the allocator (A::pointer if there is one, T* otherwise,
+like std::allocator_traits), so the same Vector<T, A> works with both allocators.
+
+The segment starts with a Shm_header: magic, layout version, element size and a state word. The
+builder stores "ready" (release) only when the vector is complete; readers wait for it (acquire)
+before they look at anything else, and map the segment read-only.
+
+Only trivially copyable T can be shared: anything holding a pointer, a vtable or a file handle
+would be meaningless in the other processes.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// a pointer stored as the distance from its own address to the target, so it stays valid when
+// the memory holding both is mapped somewhere else; 1 means null (an Offset_ptr never points
+// one byte into itself). The arithmetic is done on integers: subtracting pointers into
+// different objects is undefined, and the optimizer does take advantage of that.
+template <typename T>
+class Offset_ptr {
+  std::uintptr_t off = 1;
+
+  void set(const T* p) {
+    off = p ? reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(this) : 1;
+  }
+
+ public:
+  Offset_ptr() = default;
+  Offset_ptr(T* p) { set(p); }
+
+  // a copy lives at another address, so the offset to the same target is different
+  Offset_ptr(const Offset_ptr& o) { set(o.get()); }
+  Offset_ptr& operator=(const Offset_ptr& o) {
+    set(o.get());
+    return *this;
+  }
+
+  T* get() const {
+    if (off == 1) return nullptr;
+    auto self = reinterpret_cast<std::uintptr_t>(this);
+    return reinterpret_cast<T*>(self + off);
+  }
+
+  operator T*() const { return get(); }
+  T* operator->() const { return get(); }
+};
+
+// A::pointer if the allocator defines one, T* otherwise
+template <typename T, typename A>
+struct Pointer_of {
+  using type = T*;
+};
+
+template <typename T, typename A>
+  requires requires { typename A::pointer; }
+struct Pointer_of<T, A> {
+  using type = typename A::pointer;
+};
+
+template <typename T>
+struct Allocator {
+  T* allocate(int n) {
+    if (n <= 0) return nullptr;
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, int n) { ::operator delete(p, n * sizeof(T)); }
+};
+
+template <typename T, typename A>
+struct Vector_rep {
+  using pointer = typename Pointer_of<T, A>::type;
+
+  A alloc;
+  int sz;
+  pointer elem;
+  int space;
+
+  Vector_rep(const A& a, int n) : alloc{a}, sz{0}, elem{alloc.allocate(n)}, space{n} {}
+
+  Vector_rep(const Vector_rep&) = delete;
+  Vector_rep& operator=(const Vector_rep&) = delete;
+
+  ~Vector_rep() { alloc.deallocate(elem, space); }
+
+  void swap_storage(Vector_rep& b) {
+    std::swap(sz, b.sz);
+    std::swap(elem, b.elem);
+    std::swap(space, b.space);
+  }
+
+  // the elements as a plain T*, whatever pointer type elem is
+  T* data() const { return elem; }
+};
+
+template <typename T, typename A = Allocator<T>>
+class Vector {
+  Vector_rep<T, A> r;
+
+ public:
+  explicit Vector(const A& a = A{}) : r{a, 0} {}
+
+  Vector(const Vector&) = delete;
+  Vector& operator=(const Vector&) = delete;
+
+  ~Vector() { std::destroy(r.data(), r.data() + r.sz); }
+
+  T& operator[](int n) { return r.data()[n]; }
+  const T& operator[](int n) const { return r.data()[n]; }
+
+  int size() const { return r.sz; }
+  int capacity() const { return r.space; }
+
+  void reserve(int newalloc);
+  void push_back(const T& val);
+
+  const T* begin() const { return r.data(); }
+  const T* end() const { return r.data() + r.sz; }
+};
+
+template <typename T, typename A>
+void Vector<T, A>::reserve(int newalloc) {
+  if (newalloc <= r.space) return;
+
+  Vector_rep<T, A> b{r.alloc, newalloc};
+  std::uninitialized_move(r.data(), r.data() + r.sz, b.data());
+  std::destroy(r.data(), r.data() + r.sz);
+  b.sz = r.sz;
+  r.swap_storage(b);
+}
+
+template <typename T, typename A>
+void Vector<T, A>::push_back(const T& val) {
+  if (r.sz == r.space) reserve(r.space == 0 ? 8 : 2 * r.space);
+  std::construct_at(r.data() + r.sz, val);
+  ++r.sz;
+}
+
+// first bytes of every segment; a freshly sized shm object is all zeros, i.e. state == empty
+struct Shm_header {
+  enum State : std::uint32_t { empty = 0, building = 1, ready = 2 };
+
+  static constexpr char magic_value[4] = {'L', 'S', 'H', 'M'};
+  static constexpr std::uint32_t layout_version = 1;
+
+  char magic[4];
+  std::uint32_t version;
+  std::atomic<std::uint32_t> state;
+  std::uint32_t elem_size;  // sizeof(T) of the shared Vector<T>
+  std::uint64_t size;  // bytes in the segment
+  std::uint64_t used;  // bytes handed out by Shm_allocator, counted from the segment start
+  std::uint64_t root;  // offset of the shared Vector from the segment start
+
+  explicit Shm_header(std::uint64_t bytes)
+      : magic{magic_value[0], magic_value[1], magic_value[2], magic_value[3]},
+        version{layout_version},
+        state{building},
+        elem_size{0},
+        size{bytes},
+        used{sizeof(Shm_header)},
+        root{0} {}
+};
+
+// other processes read state through their own mapping: it must not need a lock
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+// bump allocation inside the segment; only the builder allocates, before the segment is ready,
+// so there is no locking. deallocate does nothing: the space goes away with the segment
+template <typename T>
+struct Shm_allocator {
+  using pointer = Offset_ptr<T>;
+
+  Offset_ptr<Shm_header> seg;
+
+  explicit Shm_allocator(Shm_header* h) : seg{h} {}
+
+  T* allocate(int n) {
+    if (n <= 0) return nullptr;
+    Shm_header* h = seg;
+    std::uint64_t start = (h->used + alignof(T) - 1) / alignof(T) * alignof(T);
+    std::uint64_t end = start + std::uint64_t(n) * sizeof(T);
+    if (end > h->size) throw std::bad_alloc{};
+    h->used = end;
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(h) + start);
+  }
+
+  void deallocate(T*, int) {}
+};
+
+template <typename T>
+using Shared_vector = Vector<T, Shm_allocator<T>>;
+
+// an open file descriptor, closed on every way out
+struct Fd {
+  int fd;
+  ~Fd() {
+    if (fd >= 0) ::close(fd);
+  }
+};
+
+// a mapped POSIX shared-memory object. The process that created it removes the name when the
+// Shm_segment goes away; processes that still have it mapped keep their mapping.
+class Shm_segment {
+  std::string name;
+  void* base;
+  std::size_t bytes;
+  bool owner;
+
+  Shm_segment(std::string nm, void* b, std::size_t n, bool own)
+      : name{std::move(nm)}, base{b}, bytes{n}, owner{own} {}
+
+ public:
+  // name must start with '/'; fails if an object of that name already exists
+  static Shm_segment create(const std::string& name, std::size_t bytes);
+
+  // maps name read-only, waiting up to timeout for the builder to create and publish it
+  static Shm_segment attach(const std::string& name, std::chrono::milliseconds timeout);
+
+  Shm_segment(Shm_segment&& s) noexcept
+      : name{std::move(s.name)},
+        base{std::exchange(s.base, MAP_FAILED)},
+        bytes{s.bytes},
+        owner{std::exchange(s.owner, false)} {}
+  Shm_segment& operator=(Shm_segment&&) = delete;
+
+  ~Shm_segment() {
+    if (base != MAP_FAILED) ::munmap(base, bytes);
+    if (owner) ::shm_unlink(name.c_str());
+  }
+
+  Shm_header* header() const { return static_cast<Shm_header*>(base); }
+
+  // builder: construct the (empty) shared vector inside the segment
+  template <typename T>
+  Shared_vector<T>& make_vector();
+
+  // builder: make everything written so far visible to the readers
+  void publish() { header()->state.store(Shm_header::ready, std::memory_order_release); }
+
+  // reader: the vector the builder made; throws if it does not hold T
+  template <typename T>
+  const Shared_vector<T>& find() const;
+};
+
+Shm_segment Shm_segment::create(const std::string& name, std::size_t bytes) {
+  Fd f{::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600)};
+  if (f.fd < 0) throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+  Shm_segment s{name, MAP_FAILED, bytes, true};  // unlinks the name again if anything fails
+  if (::ftruncate(f.fd, bytes) < 0)
+    throw std::system_error(errno, std::generic_category(), "ftruncate " + name);
+  s.base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, f.fd, 0);
+  if (s.base == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap");
+  new (s.base) Shm_header{bytes};
+  return s;
+}
+
+Shm_segment Shm_segment::attach(const std::string& name, std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto wait_until_deadline = [&](const char* what) {
+    if (std::chrono::steady_clock::now() > deadline)
+      throw std::runtime_error(name + ": timed out waiting for the segment to be " + what);
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  };
+
+  // the builder may not have created the object yet...
+  Fd f{-1};
+  while ((f.fd = ::shm_open(name.c_str(), O_RDONLY, 0)) < 0) {
+    if (errno != ENOENT)
+      throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+    wait_until_deadline("created");
+  }
+
+  // ...or not given it a size
+  struct stat st;
+  for (;;) {
+    if (::fstat(f.fd, &st) < 0) throw std::system_error(errno, std::generic_category(), "fstat");
+    if (std::size_t(st.st_size) >= sizeof(Shm_header)) break;
+    wait_until_deadline("sized");
+  }
+
+  std::size_t bytes = st.st_size;
+  void* base = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, f.fd, 0);
+  if (base == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap");
+  Shm_segment s{name, base, bytes, false};
+
+  // nothing but state may be read before it says ready
+  const Shm_header* h = s.header();
+  while (h->state.load(std::memory_order_acquire) != Shm_header::ready)
+    wait_until_deadline("ready");
+
+  if (!std::equal(h->magic, h->magic + 4, Shm_header::magic_value) ||
+      h->version != Shm_header::layout_version || h->size != bytes)
+    throw std::runtime_error(name + ": not a version " +
+                             std::to_string(Shm_header::layout_version) + " segment");
+  return s;
+}
+
+template <typename T>
+Shared_vector<T>& Shm_segment::make_vector() {
+  static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be shared");
+  Shm_header* h = header();
+  Shared_vector<T>* v = Shm_allocator<Shared_vector<T>>{h}.allocate(1);
+  std::construct_at(v, Shm_allocator<T>{h});
+  h->root = reinterpret_cast<char*>(v) - static_cast<char*>(base);
+  h->elem_size = sizeof(T);
+  return *v;
+}
+
+template <typename T>
+const Shared_vector<T>& Shm_segment::find() const {
+  const Shm_header* h = header();
+  if (h->root == 0 || h->elem_size != sizeof(T))
+    throw std::runtime_error(name + ": holds no Vector of " + std::to_string(sizeof(T)) +
+                             "-byte elements");
+  return *reinterpret_cast<const Shared_vector<T>*>(static_cast<const char*>(base) + h->root);
+}
+
+// ---------------------------------------------------------------------------------------------
+
+using Clock = std::chrono::steady_clock;
+
+// read a file of ints into v, the way every process would without shared memory
+template <typename A>
+void load(const char* path, Vector<int, A>& v) {
+  std::FILE* f = std::fopen(path, "rb");
+  if (!f) throw std::system_error(errno, std::generic_category(), path);
+  std::fseek(f, 0, SEEK_END);
+  v.reserve(int(std::ftell(f) / sizeof(int)));
+  std::fseek(f, 0, SEEK_SET);
+  int buf[1 << 14];
+  std::size_t got;
+  while ((got = std::fread(buf, sizeof(int), std::size(buf), f)) > 0)
+    for (std::size_t i = 0; i < got; ++i) v.push_back(buf[i]);
+  std::fclose(f);
+}
+
+template <typename V>
+long long sum(const V& v) {
+  long long s = 0;
+  for (int x : v) s += x;
+  return s;
+}
+
+// resident and proportional set size in KB: Rss counts a shared page in full in every process
+// that maps it, Pss divides it between them
+struct Mem_usage {
+  long rss_kb = -1;
+  long pss_kb = -1;
+};
+
+Mem_usage memory_usage() {
+  Mem_usage m;
+  std::ifstream in("/proc/self/smaps_rollup");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.starts_with("Rss:")) m.rss_kb = std::stol(line.substr(4));
+    if (line.starts_with("Pss:")) m.pss_kb = std::stol(line.substr(4));
+  }
+  return m;
+}
+
+// what each child process reports back, through an anonymous shared mapping
+struct Child_result {
+  double get_s;  // load from the file, or attach
+  double sum_s;  // first pass over the data
+  long long sum;
+  Mem_usage mem;
+};
+
+Child_result* shared_results(int n) {
+  void* p = ::mmap(nullptr, n * sizeof(Child_result), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap");
+  return static_cast<Child_result*>(p);
+}
+
+// runs body(i) in n child processes; a child exits 0 if body returns true, 1 if it returns
+// false or throws
+template <typename F>
+std::vector<pid_t> spawn(int n, F body) {
+  std::cout.flush();  // or the children flush the parent's buffered output again
+  std::vector<pid_t> pids;
+  for (int i = 0; i < n; ++i) {
+    pid_t pid = ::fork();
+    if (pid < 0) throw std::system_error(errno, std::generic_category(), "fork");
+    if (pid == 0) {
+      bool ok = false;
+      try {
+        ok = body(i);
+      } catch (const std::exception& e) {
+        std::cerr << "  child " << i << ": " << e.what() << "\n";
+      }
+      std::_Exit(ok ? 0 : 1);
+    }
+    pids.push_back(pid);
+  }
+  return pids;
+}
+
+// raw wait statuses, in the order of pids
+std::vector<int> wait_all(const std::vector<pid_t>& pids) {
+  std::vector<int> status;
+  for (pid_t pid : pids) {
+    int st = 0;
+    ::waitpid(pid, &st, 0);
+    status.push_back(st);
+  }
+  return status;
+}
+
+bool exited_ok(int st) { return WIFEXITED(st) && WEXITSTATUS(st) == 0; }
+
+std::size_t segment_bytes(int n) {
+  return sizeof(Shm_header) + sizeof(Shared_vector<int>) + n * sizeof(int) + 64;
+}
+
+std::string segment_name(const char* what) {
+  return "/learn-cpp-" + std::string(what) + "-" + std::to_string(::getpid());
+}
+
+// readers started before the segment exists must wait for it, then all see the same data;
+// a reader that writes must be stopped by the read-only mapping; asking for the wrong element
+// type must fail. Returns the number of failed checks.
+int multi_process_test(const char* path, int n, long long expected, int procs) {
+  std::cout << "Multi-process test\n";
+  int failures = 0;
+  auto check = [&](bool ok, const std::string& what) {
+    std::cout << "  " << (ok ? "ok    " : "FAILED") << "  " << what << "\n";
+    if (!ok) ++failures;
+  };
+
+  const std::string name = segment_name("shm-test");
+  auto readers = spawn(procs, [&](int) {
+    Shm_segment s = Shm_segment::attach(name, std::chrono::seconds{10});
+    const Shared_vector<int>& v = s.find<int>();
+    return v.size() == n && sum(v) == expected;
+  });
+  auto writer = spawn(1, [&](int) {
+    ::rlimit no_core{0, 0};
+    ::setrlimit(RLIMIT_CORE, &no_core);
+    Shm_segment s = Shm_segment::attach(name, std::chrono::seconds{10});
+    const_cast<int&>(s.find<int>()[0]) = -1;  // must not get past this
+    return true;
+  });
+
+  {
+    Shm_segment s = Shm_segment::create(name, segment_bytes(n));
+    load(path, s.make_vector<int>());
+    s.publish();
+
+    std::vector<int> st = wait_all(readers);
+    check(std::all_of(st.begin(), st.end(), exited_ok),
+          std::to_string(procs) + " readers attached before publish() see all " +
+              std::to_string(n) + " elements");
+
+    int w = wait_all(writer)[0];
+    check(WIFSIGNALED(w) && WTERMSIG(w) == SIGSEGV, "a reader writing to the vector gets SIGSEGV");
+    check(sum(s.find<int>()) == expected, "the vector is unchanged after that");
+
+    bool rejected = false;
+    try {
+      Shm_segment::attach(name, std::chrono::seconds{1}).find<double>();
+    } catch (const std::runtime_error&) {
+      rejected = true;
+    }
+    check(rejected, "find<double>() on a Vector<int> segment throws");
+  }
+
+  bool removed = false;
+  try {
+    Shm_segment::attach(name, std::chrono::milliseconds{10});
+  } catch (const std::runtime_error&) {
+    removed = true;
+  }
+  check(removed, "the name is gone once the builder's Shm_segment is destroyed");
+  return failures;
+}
+
+void print_results(const char* label, const Child_result* r, int procs, long extra_pss_kb) {
+  double get_s = 0, sum_s = 0;
+  long rss = 0, pss = 0;
+  for (int i = 0; i < procs; ++i) {
+    get_s += r[i].get_s;
+    sum_s += r[i].sum_s;
+    rss += r[i].mem.rss_kb;
+    pss += r[i].mem.pss_kb;
+  }
+  std::cout << "  " << label << ": " << get_s / procs * 1e3 << " ms to get the data, "
+            << sum_s / procs * 1e3 << " ms first pass, per process RSS " << rss / procs / 1024
+            << " MB PSS " << pss / procs / 1024 << " MB, total PSS "
+            << (pss + extra_pss_kb) / 1024 << " MB\n";
+}
+
+int bench(const char* path, int n, long long expected, int procs) {
+  std::cout << "\n" << procs << " processes reading " << n * sizeof(int) / (1 << 20)
+            << " MB of ints (averages per process)\n";
+  Child_result* r = shared_results(procs);
+  int failures = 0;
+
+  // every process loads its own copy
+  auto pids = spawn(procs, [&](int i) {
+    auto t0 = Clock::now();
+    Vector<int> v;
+    load(path, v);
+    auto t1 = Clock::now();
+    r[i].sum = sum(v);
+    r[i].get_s = std::chrono::duration<double>(t1 - t0).count();
+    r[i].sum_s = std::chrono::duration<double>(Clock::now() - t1).count();
+    r[i].mem = memory_usage();
+    return r[i].sum == expected;
+  });
+  for (int st : wait_all(pids)) failures += !exited_ok(st);
+  print_results("private copies", r, procs, 0);
+
+  // one process builds the segment, the others attach
+  const std::string name = segment_name("shm-bench");
+  auto t0 = Clock::now();
+  Shm_segment s = Shm_segment::create(name, segment_bytes(n));
+  load(path, s.make_vector<int>());
+  s.publish();
+  double build_ms = std::chrono::duration<double>(Clock::now() - t0).count() * 1e3;
+
+  pids = spawn(procs, [&](int i) {
+    auto t0 = Clock::now();
+    Shm_segment seg = Shm_segment::attach(name, std::chrono::seconds{10});
+    const Shared_vector<int>& v = seg.find<int>();
+    auto t1 = Clock::now();
+    r[i].sum = sum(v);
+    r[i].get_s = std::chrono::duration<double>(t1 - t0).count();
+    r[i].sum_s = std::chrono::duration<double>(Clock::now() - t1).count();
+    r[i].mem = memory_usage();
+    return r[i].sum == expected;
+  });
+  for (int st : wait_all(pids)) failures += !exited_ok(st);
+  // the builder's share of the segment counts too
+  print_results("shared segment", r, procs, memory_usage().pss_kb);
+  std::cout << "  (building the segment once: " << build_ms << " ms)\n";
+
+  ::munmap(r, procs * sizeof(Child_result));
+  return failures;
+}
+
+int main(int argc, char* argv[]) {
+  const int n = argc > 1 ? std::atoi(argv[1]) : 8 << 20;
+  const int procs = 4;
+  std::cout << "Shared-memory Vector\n\n";
+
+  // the data every process wants: one file of ints
+  char path[] = "/tmp/learn-shm-vector-XXXXXX";
+  int fd = ::mkstemp(path);
+  if (fd < 0) {
+    std::cerr << "cannot create a temporary file\n";
+    return 1;
+  }
+  long long expected = 0;
+  {
+    Vector<int> data;
+    data.reserve(n);
+    for (int i = 0; i < n; ++i) data.push_back(i * 7 % 1000);
+    expected = sum(data);
+    std::FILE* f = ::fdopen(fd, "wb");
+    std::fwrite(data.begin(), sizeof(int), data.size(), f);
+    std::fclose(f);
+  }
+
+  int failures = 0;
+  try {
+    failures += multi_process_test(path, n, expected, procs);
+    failures += bench(path, n, expected, procs);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    ++failures;
+  }
+  std::remove(path);
+
+  /*
+  Observation (one run, 32 MB of ints, 4 readers): loading a private copy took about 90 ms per
+  process, attaching to the segment 0.05 ms (shm_open + mmap + header checks: no data is
+  touched). The first pass over the data costs about the same either way (~20 ms), because the
+  shared pages are faulted into each reader's page table on first use. RSS is 34 MB in every
+  process in both cases, since RSS counts shared pages in full; PSS shows the difference:
+  32 MB per process for private copies against 11 MB when the 32 MB are split 5 ways (the
+  builder keeps its mapping), and 131 MB against 81 MB in total.
+  */
+
+  return failures == 0 ? 0 : 1;
+}
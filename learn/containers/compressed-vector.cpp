@@ -0,0 +1,365 @@
+/*
+
+Compressed integer vector
+
+A Vector<int> always spends 4 bytes per element. If the values in a column are small, or
+sorted, most of those bits are zero. Compressed_vector stores blocks of 128 ints:
+
+- frame of reference (FOR): subtract the block minimum, so every value fits in b bits, where b
+  is the bit width of (max - min)
+- delta: for a non-decreasing block, store the differences between neighbours instead, which
+  are usually much smaller than the values
+- bit packing: 128 values of b bits take exactly 4 * b 32-bit words
+
+Each block keeps a small header (base, mode, bit width, offset of its words), so operator[]
+finds the block, then the b bits of one value. A FOR block decodes one value in O(1); a delta
+block has to add up the deltas before it (at most 127).
+
+The packed words use a "vertical" layout with 4 lanes: value i of a block goes into lane i % 4,
+and word k of lane j is stored at 4 * k + j. One 128-bit SSE2 load then holds the same word of
+all four lanes, and one shift + mask produces four consecutive values at a time.
+
+Read-only: it is built once from an existing Vector<int>.
+
+*/
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+template <typename T>
+struct Allocator {
+  T* allocate(int n) {
+    if (n <= 0) return nullptr;
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, int n) { ::operator delete(p, n * sizeof(T)); }
+};
+
+template <typename T, typename A>
+struct Vector_rep {
+  A alloc;
+  int sz;
+  T* elem;
+  int space;
+
+  Vector_rep(const A& a, int n) : alloc{a}, sz{0}, elem{alloc.allocate(n)}, space{n} {}
+
+  Vector_rep(const Vector_rep&) = delete;
+  Vector_rep& operator=(const Vector_rep&) = delete;
+
+  ~Vector_rep() { alloc.deallocate(elem, space); }
+
+  void swap_storage(Vector_rep& other) noexcept {
+    std::swap(sz, other.sz);
+    std::swap(elem, other.elem);
+    std::swap(space, other.space);
+  }
+};
+
+template <typename T, typename A = Allocator<T>>
+class Vector {
+  Vector_rep<T, A> r;
+
+ public:
+  Vector() : r{A{}, 0} {}
+
+  explicit Vector(int s) : r{A{}, s} {
+    std::uninitialized_fill(r.elem, r.elem + s, T{});
+    r.sz = s;
+  }
+
+  Vector(const Vector&) = delete;
+  Vector& operator=(const Vector&) = delete;
+
+  ~Vector() { std::destroy(r.elem, r.elem + r.sz); }
+
+  T& operator[](int n) { return r.elem[n]; }
+  const T& operator[](int n) const { return r.elem[n]; }
+
+  int size() const { return r.sz; }
+  int capacity() const { return r.space; }
+
+  void reserve(int newalloc) {
+    if (newalloc <= r.space) return;
+    Vector_rep<T, A> b{r.alloc, newalloc};
+    std::uninitialized_move(r.elem, r.elem + r.sz, b.elem);
+    std::destroy(r.elem, r.elem + r.sz);
+    b.sz = r.sz;
+    r.swap_storage(b);
+  }
+
+  void push_back(const T& val) {
+    if (r.sz == r.space) reserve(r.space == 0 ? 8 : 2 * r.space);
+    std::construct_at(&r.elem[r.sz], val);
+    ++r.sz;
+  }
+
+  T* begin() const { return r.elem; }
+  T* end() const { return r.elem + r.sz; }
+};
+
+class Compressed_vector {
+ public:
+  static constexpr int block_size = 128;
+  static constexpr int lanes = 4;
+
+  enum class Mode : std::uint8_t { frame_of_reference, delta };
+
+  struct Block_header {
+    std::int32_t base;    // FOR: block minimum; delta: first value
+    std::uint32_t words;  // offset of the block's packed words
+    std::uint8_t bits;    // bits per packed value, 0..32
+    Mode mode;
+  };
+
+  explicit Compressed_vector(const Vector<int>& v) : n{v.size()} {
+    std::uint32_t packed[block_size];
+    for (int b = 0; b < n; b += block_size) {
+      int m = std::min(block_size, n - b);
+      Block_header h = encode_block(&v[b], m, packed);
+      h.words = std::uint32_t(words.size());
+      headers.push_back(h);
+      pack(packed, h.bits);
+    }
+  }
+
+  int size() const { return n; }
+
+  // bytes used, including the headers
+  long long bytes() const {
+    return (long long)headers.size() * sizeof(Block_header) +
+           (long long)words.size() * sizeof(std::uint32_t);
+  }
+
+  int operator[](int i) const {
+    const Block_header& h = headers[i / block_size];
+    const std::uint32_t* w = words.begin() + h.words;
+    int k = i % block_size;
+    if (h.mode == Mode::frame_of_reference) return h.base + int(extract(w, h.bits, k));
+
+    std::uint32_t sum = std::uint32_t(h.base);
+    for (int j = 1; j <= k; ++j) sum += extract(w, h.bits, j);
+    return int(sum);
+  }
+
+  // calls f(values, count) for every block in order, with the block decoded into a buffer
+  template <typename F>
+  void for_each_block(F f) const {
+    alignas(16) std::int32_t buf[block_size];
+    for (int b = 0; b < headers.size(); ++b) {
+      decode_block(b, buf);
+      f(static_cast<const int*>(buf), std::min(block_size, n - b * block_size));
+    }
+  }
+
+ private:
+  int n;
+  Vector<Block_header> headers;
+  Vector<std::uint32_t> words;
+
+  // choose the smaller of FOR and delta; fills packed[0..127] with the unsigned values to pack
+  static Block_header encode_block(const int* v, int m, std::uint32_t* packed) {
+    int lo = *std::min_element(v, v + m);
+    int hi = *std::max_element(v, v + m);
+    int for_bits = std::bit_width(std::uint32_t(hi) - std::uint32_t(lo));
+
+    bool sorted = std::is_sorted(v, v + m);
+    std::uint32_t max_delta = 0;
+    for (int i = 1; sorted && i < m; ++i)
+      max_delta = std::max(max_delta, std::uint32_t(v[i]) - std::uint32_t(v[i - 1]));
+    int delta_bits = std::bit_width(max_delta);
+
+    Block_header h{};
+    if (sorted && delta_bits < for_bits) {
+      h = {v[0], 0, std::uint8_t(delta_bits), Mode::delta};
+      packed[0] = 0;
+      for (int i = 1; i < m; ++i) packed[i] = std::uint32_t(v[i]) - std::uint32_t(v[i - 1]);
+      std::fill(packed + m, packed + block_size, 0);  // padding repeats the last value
+    } else {
+      h = {lo, 0, std::uint8_t(for_bits), Mode::frame_of_reference};
+      for (int i = 0; i < m; ++i) packed[i] = std::uint32_t(v[i]) - std::uint32_t(lo);
+      std::fill(packed + m, packed + block_size, 0);
+    }
+    return h;
+  }
+
+  // append 4 * bits words: lane j holds values j, j + 4, j + 8, ... as a little-endian bit stream
+  void pack(const std::uint32_t* vals, int bits) {
+    if (bits == 0) return;  // constant block: the header's base is every value
+    int first = words.size();
+    for (int i = 0; i < lanes * bits; ++i) words.push_back(0);
+    std::uint32_t* w = words.begin() + first;
+    for (int i = 0; i < block_size; ++i) {
+      int lane = i % lanes;
+      int pos = (i / lanes) * bits;  // bit position within the lane
+      int k = pos / 32;
+      int off = pos % 32;
+      w[lanes * k + lane] |= vals[i] << off;
+      if (off + bits > 32) w[lanes * (k + 1) + lane] |= vals[i] >> (32 - off);
+    }
+  }
+
+  // value k of a block, as packed
+  static std::uint32_t extract(const std::uint32_t* w, int bits, int k) {
+    if (bits == 0) return 0;
+    int lane = k % lanes;
+    int pos = (k / lanes) * bits;
+    int word = pos / 32;
+    int off = pos % 32;
+    std::uint64_t x = w[lanes * word + lane];
+    if (off + bits > 32) x |= std::uint64_t(w[lanes * (word + 1) + lane]) << 32;
+    return std::uint32_t(x >> off) & mask(bits);
+  }
+
+  static std::uint32_t mask(int bits) { return bits == 32 ? ~0u : (1u << bits) - 1; }
+
+  void decode_block(int b, std::int32_t* out) const {
+    const Block_header& h = headers[b];
+    const std::uint32_t* w = words.begin() + h.words;
+#if defined(__SSE2__)
+    const __m128i m = _mm_set1_epi32(int(mask(h.bits)));
+    __m128i base = _mm_set1_epi32(h.base);
+    auto* dst = reinterpret_cast<__m128i*>(out);
+    for (int g = 0; g < block_size / lanes; ++g) {
+      // four consecutive values g*4 .. g*4+3, one per lane
+      __m128i x;
+      if (h.bits == 0) {
+        x = _mm_setzero_si128();
+      } else {
+        int pos = g * h.bits;
+        int k = pos / 32;
+        int off = pos % 32;
+        x = _mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + lanes * k)),
+                          _mm_cvtsi32_si128(off));
+        if (off + h.bits > 32) {
+          __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + lanes * (k + 1)));
+          x = _mm_or_si128(x, _mm_sll_epi32(next, _mm_cvtsi32_si128(32 - off)));
+        }
+        x = _mm_and_si128(x, m);
+      }
+      if (h.mode == Mode::frame_of_reference) {
+        _mm_store_si128(dst + g, _mm_add_epi32(x, base));
+      } else {
+        // prefix sum of the four lanes, plus the running total carried in base
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, base);
+        _mm_store_si128(dst + g, x);
+        base = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+      }
+    }
+#else
+    std::uint32_t sum = std::uint32_t(h.base);
+    for (int k = 0; k < block_size; ++k) {
+      std::uint32_t x = extract(w, h.bits, k);
+      if (h.mode == Mode::frame_of_reference) {
+        out[k] = int(std::uint32_t(h.base) + x);
+      } else {
+        sum += x;
+        out[k] = int(sum);
+      }
+    }
+#endif
+  }
+};
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+void bench(const char* name, const Vector<int>& v, std::mt19937& gen) {
+  const int n = v.size();
+  Compressed_vector c{v};
+
+  // every element must come back unchanged, both ways
+  bool ok = true;
+  for (int i = 0; i < n; i += 97) ok = ok && c[i] == v[i];
+  long long pos = 0;
+  c.for_each_block([&](const int* vals, int m) {
+    for (int i = 0; i < m; ++i) ok = ok && vals[i] == v[int(pos + i)];
+    pos += m;
+  });
+
+  const int reps = 10;
+  long long sum_plain = 0;
+  auto t0 = Clock::now();
+  for (int r = 0; r < reps; ++r)
+    for (int x : v) sum_plain += x;
+  double scan_plain = seconds_since(t0);
+
+  long long sum_c = 0;
+  t0 = Clock::now();
+  for (int r = 0; r < reps; ++r)
+    c.for_each_block([&](const int* vals, int m) {
+      for (int i = 0; i < m; ++i) sum_c += vals[i];
+    });
+  double scan_c = seconds_since(t0);
+
+  const int n_random = 1'000'000;
+  Vector<int> idx(n_random);
+  std::uniform_int_distribution<int> pick{0, n - 1};
+  for (int i = 0; i < n_random; ++i) idx[i] = pick(gen);
+  long long s1 = 0, s2 = 0;
+  t0 = Clock::now();
+  for (int i : idx) s1 += v[i];
+  double rand_plain = seconds_since(t0);
+  t0 = Clock::now();
+  for (int i : idx) s2 += c[i];
+  double rand_c = seconds_since(t0);
+
+  double gb = double(n) * reps * sizeof(int) / 1e9;  // decoded bytes scanned
+  std::cout << "  " << name << ": " << (ok && sum_plain == sum_c && s1 == s2 ? "" : "MISMATCH ")
+            << "ratio " << double(c.bytes()) / (double(n) * sizeof(int)) << ", scan GB/s plain "
+            << gb / scan_plain << " compressed " << gb / scan_c << ", random ns plain "
+            << rand_plain * 1e9 / n_random << " compressed " << rand_c * 1e9 / n_random << "\n";
+}
+
+int main() {
+  std::cout << "Compressed integer vector\n";
+
+  const int n = 10'000'000;
+  std::mt19937 gen{3};
+
+  Vector<int> small(n), sorted(n), noisy(n), wide(n), constant(n);
+  std::uniform_int_distribution<int> byte{0, 255};
+  std::uniform_int_distribution<int> step{0, 15};
+  std::uniform_int_distribution<int> any;
+  int acc = -1000;
+  for (int i = 0; i < n; ++i) {
+    small[i] = byte(gen);
+    acc += step(gen);
+    sorted[i] = acc;
+    noisy[i] = 1'000'000 + byte(gen) - 128;  // large values in a narrow range: FOR
+    wide[i] = any(gen);                      // incompressible
+    constant[i] = 42;                        // 0-bit blocks: headers only
+  }
+
+  bench("0..255        ", small, gen);
+  bench("sorted, step<16", sorted, gen);
+  bench("1e6 +- 128    ", noisy, gen);
+  bench("full range    ", wide, gen);
+  bench("constant 42   ", constant, gen);
+
+  /*
+  Observation (two runs, 10M ints): 0..255 and 1e6 +- 128 shrink to 27% (8 bits per value plus
+  headers), the sorted column to 15% (4-bit deltas), a constant column to 2% (headers only, no
+  packed words). Scans of the compressed columns decode at 60-75% of the plain scan's rate
+  while reading a quarter of the bytes; the constant column scans faster than plain. Random
+  access costs 3-5x a plain load for FOR blocks and much more for delta blocks, which sum up to
+  127 deltas. Full-range random ints do not compress.
+  */
+
+  return 0;
+}
@@ -0,0 +1,418 @@
+/*
+
+Open-addressing hash table (SwissTable layout)
+
+std::unordered_map allocates one node per element and chains them from buckets. Here all
+elements live in one slot array, and a parallel array of one-byte "control" values says what is
+in each slot:
+
+  empty    = -128 (0b10000000)
+  deleted  = -2   (0b11111110)  a tombstone: the slot is free, but a probe must not stop here
+  full     = 0..127             the low 7 bits of the element's hash (h2)
+
+The table is split into groups of 16 slots. A lookup hashes the key once: the high bits (h1)
+pick the first group, h2 is compared against all 16 control bytes of the group with one SSE2
+compare. Only slots whose h2 matches are compared with the key. A group that still has an empty
+slot ends the search.
+
+Slots and control bytes are both raw buffers owned by a Vector_rep, like the elements of
+Vector<T, A>, so the table allocates only when it grows.
+
+*/
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+template <typename T>
+struct Allocator {
+  T* allocate(int n) {
+    if (n <= 0) return nullptr;
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, int n) { ::operator delete(p, n * sizeof(T)); }
+};
+
+template <typename T, typename A>
+struct Vector_rep {
+  A alloc;
+  int sz;
+  T* elem;
+  int space;
+
+  Vector_rep(const A& a, int n) : alloc{a}, sz{0}, elem{alloc.allocate(n)}, space{n} {}
+
+  Vector_rep(const Vector_rep&) = delete;
+  Vector_rep& operator=(const Vector_rep&) = delete;
+
+  ~Vector_rep() { alloc.deallocate(elem, space); }
+
+  void swap_storage(Vector_rep& other) noexcept {
+    std::swap(sz, other.sz);
+    std::swap(elem, other.elem);
+    std::swap(space, other.space);
+  }
+};
+
+using ctrl_t = std::int8_t;
+constexpr ctrl_t ctrl_empty = -128;
+constexpr ctrl_t ctrl_deleted = -2;
+constexpr int group_size = 16;
+
+// 16 control bytes; each match returns a bit mask with bit i set for slot i of the group
+struct Group {
+#if defined(__SSE2__)
+  __m128i ctrl;
+
+  explicit Group(const ctrl_t* p) : ctrl{_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))} {}
+
+  std::uint32_t match(ctrl_t h2) const {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+  }
+
+  // empty and deleted are the only negative values below -1
+  std::uint32_t match_empty_or_deleted() const {
+    return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+  }
+#else
+  ctrl_t ctrl[group_size];
+
+  explicit Group(const ctrl_t* p) { std::memcpy(ctrl, p, group_size); }
+
+  std::uint32_t match(ctrl_t h2) const {
+    std::uint32_t m = 0;
+    for (int i = 0; i < group_size; ++i) m |= std::uint32_t(ctrl[i] == h2) << i;
+    return m;
+  }
+
+  std::uint32_t match_empty_or_deleted() const {
+    std::uint32_t m = 0;
+    for (int i = 0; i < group_size; ++i) m |= std::uint32_t(ctrl[i] < -1) << i;
+    return m;
+  }
+#endif
+
+  std::uint32_t match_empty() const { return match(ctrl_empty); }
+};
+
+// std::hash<int> is the identity on common implementations, which would put every small key's
+// h2 in the same few values; mix the bits first
+inline std::size_t mix(std::size_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// transparent hash: std::string, std::string_view and const char* hash the same way, so a
+// table keyed by std::string can be searched with a string_view without building a string
+struct Default_hash {
+  using is_transparent = void;
+
+  template <typename Q>
+  std::size_t operator()(const Q& q) const {
+    if constexpr (std::is_convertible_v<const Q&, std::string_view>)
+      return mix(std::hash<std::string_view>{}(std::string_view{q}));
+    else
+      return mix(std::hash<Q>{}(q));
+  }
+};
+
+template <typename K, typename V, typename Hash = Default_hash, typename Eq = std::equal_to<>,
+          typename A = Allocator<std::pair<K, V>>>
+class Flat_hash_map {
+ public:
+  using value_type = std::pair<K, V>;
+
+  Flat_hash_map() : slots{A{}, 0}, ctrl{Allocator<ctrl_t>{}, 0} {}
+
+  Flat_hash_map(const Flat_hash_map&) = delete;
+  Flat_hash_map& operator=(const Flat_hash_map&) = delete;
+
+  ~Flat_hash_map() { destroy_all(); }
+
+  int size() const { return sz; }
+  int capacity() const { return slots.space; }
+  int tombstones() const { return deleted; }
+  double load_factor() const { return capacity() ? double(sz) / capacity() : 0.0; }
+
+  // make room for n elements without another rehash
+  void reserve(int n) {
+    if (n > max_load(capacity())) rehash(n);
+  }
+
+  // rebuild the table with room for at least n elements; also drops all tombstones
+  void rehash(int n) {
+    int cap = group_size;
+    while (max_load(cap) < std::max(n, sz)) cap *= 2;
+    resize(cap);
+  }
+
+  template <typename Q>
+  value_type* find(const Q& key) {
+    if (sz == 0) return nullptr;
+    int i = find_index(key, hash(key));
+    return i < 0 ? nullptr : &slots.elem[i];
+  }
+
+  template <typename Q>
+  bool contains(const Q& key) {
+    return find(key) != nullptr;
+  }
+
+  // returns the element and whether it was inserted (false: key was already there)
+  std::pair<value_type*, bool> insert(const K& key, const V& val) {
+    std::size_t h = hash(key);
+    if (sz > 0) {
+      int i = find_index(key, h);
+      if (i >= 0) return {&slots.elem[i], false};
+    }
+    int i = prepare_insert(h);
+    // construct first: if copying key or val throws, the slot is still free
+    std::construct_at(&slots.elem[i], key, val);
+    occupy(i, h);
+    return {&slots.elem[i], true};
+  }
+
+  V& operator[](const K& key) { return insert(key, V{}).first->second; }
+
+  template <typename Q>
+  bool erase(const Q& key) {
+    if (sz == 0) return false;
+    int i = find_index(key, hash(key));
+    if (i < 0) return false;
+    std::destroy_at(&slots.elem[i]);
+    --sz;
+
+    // if the group still has an empty slot, no probe ever continued past it, so the slot can
+    // become empty again; otherwise a later element may be behind it and a tombstone is needed
+    int g = i / group_size * group_size;
+    if (Group{ctrl.elem + g}.match_empty()) {
+      ctrl.elem[i] = ctrl_empty;
+      ++growth_left;
+    } else {
+      ctrl.elem[i] = ctrl_deleted;
+      ++deleted;
+    }
+    return true;
+  }
+
+  template <typename F>
+  void for_each(F f) {
+    for (int i = 0; i < capacity(); ++i)
+      if (ctrl.elem[i] >= 0) f(slots.elem[i].first, slots.elem[i].second);
+  }
+
+ private:
+  Vector_rep<value_type, A> slots;           // capacity() slots, constructed only where full
+  Vector_rep<ctrl_t, Allocator<ctrl_t>> ctrl;  // one control byte per slot
+  int sz = 0;
+  int deleted = 0;      // tombstones
+  int growth_left = 0;  // empty slots we may still fill before the load limit
+
+  Hash hasher;
+  Eq eq;
+
+  static int max_load(int cap) { return cap - cap / 8; }  // 7/8
+
+  template <typename Q>
+  std::size_t hash(const Q& key) const {
+    return hasher(key);
+  }
+
+  static ctrl_t h2(std::size_t h) { return static_cast<ctrl_t>(h & 0x7f); }
+
+  int n_groups() const { return capacity() / group_size; }
+
+  // groups are visited at offsets 0, 1, 3, 6, 10, ... (triangular numbers), which reaches every
+  // group when the number of groups is a power of two
+  template <typename Q>
+  int find_index(const Q& key, std::size_t h) const {
+    int mask = n_groups() - 1;
+    int g = int(h >> 7) & mask;
+    for (int step = 1;; ++step) {
+      Group grp{ctrl.elem + g * group_size};
+      for (std::uint32_t m = grp.match(h2(h)); m; m &= m - 1) {
+        int i = g * group_size + std::countr_zero(m);
+        if (eq(slots.elem[i].first, key)) return i;
+      }
+      if (grp.match_empty()) return -1;
+      g = (g + step) & mask;
+    }
+  }
+
+  // first empty or deleted slot on h's probe sequence
+  int find_free(std::size_t h) const {
+    int mask = n_groups() - 1;
+    int g = int(h >> 7) & mask;
+    for (int step = 1;; ++step) {
+      if (std::uint32_t m = Group{ctrl.elem + g * group_size}.match_empty_or_deleted())
+        return g * group_size + std::countr_zero(m);
+      g = (g + step) & mask;
+    }
+  }
+
+  // pick the slot for a new element with hash h, growing or cleaning the table if needed;
+  // the slot stays free until occupy()
+  int prepare_insert(std::size_t h) {
+    if (growth_left == 0) {
+      // mostly tombstones: rebuilding at the same size is enough
+      if (capacity() > 0 && sz < max_load(capacity()) / 2)
+        resize(capacity());
+      else
+        resize(capacity() == 0 ? group_size : capacity() * 2);
+    }
+    return find_free(h);
+  }
+
+  // mark slot i, which now holds an element with hash h, as full
+  void occupy(int i, std::size_t h) {
+    if (ctrl.elem[i] == ctrl_deleted)
+      --deleted;
+    else
+      --growth_left;
+    ctrl.elem[i] = h2(h);
+    ++sz;
+  }
+
+  // move every element into a fresh table of cap slots
+  void resize(int cap) {
+    // take over the current arrays; they are freed when old_* go out of scope
+    Vector_rep<value_type, A> old_slots{slots.alloc, 0};
+    Vector_rep<ctrl_t, Allocator<ctrl_t>> old_ctrl{ctrl.alloc, 0};
+    old_slots.swap_storage(slots);
+    old_ctrl.swap_storage(ctrl);
+    {
+      Vector_rep<value_type, A> fresh_slots{slots.alloc, cap};
+      Vector_rep<ctrl_t, Allocator<ctrl_t>> fresh_ctrl{ctrl.alloc, cap};
+      slots.swap_storage(fresh_slots);
+      ctrl.swap_storage(fresh_ctrl);
+    }
+    std::fill_n(ctrl.elem, ctrl.space, ctrl_empty);
+
+    sz = 0;
+    deleted = 0;
+    growth_left = max_load(cap);
+    for (int i = 0; i < old_slots.space; ++i) {
+      if (old_ctrl.elem[i] < 0) continue;
+      value_type& e = old_slots.elem[i];
+      std::size_t h = hash(e.first);
+      int j = find_free(h);
+      std::construct_at(&slots.elem[j], std::move(e));
+      std::destroy_at(&e);
+      occupy(j, h);
+    }
+  }
+
+  void destroy_all() {
+    for (int i = 0; i < capacity(); ++i)
+      if (ctrl.elem[i] >= 0) std::destroy_at(&slots.elem[i]);
+  }
+};
+
+using Clock = std::chrono::steady_clock;
+
+double ns_per_op(Clock::time_point t0, int n) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / n;
+}
+
+// reserve() argument that makes the table exactly cap slots
+int max_load_for(int cap) { return cap - cap / 8; }
+
+// capacity fixed by reserve(), then filled to the requested load factor
+void bench(int cap, double load, std::mt19937_64& gen) {
+  int n = int(cap * load);
+  std::vector<std::uint64_t> keys(n), misses(n);
+  for (auto& k : keys) k = gen();
+  for (auto& k : misses) k = gen();
+  long long check = 0;
+
+  Flat_hash_map<std::uint64_t, std::uint64_t> fm;
+  fm.reserve(max_load_for(cap));
+  std::unordered_map<std::uint64_t, std::uint64_t> um;
+  um.reserve(cap);
+
+  auto t0 = Clock::now();
+  for (int i = 0; i < n; ++i) fm.insert(keys[i], i);
+  double fi = ns_per_op(t0, n);
+  t0 = Clock::now();
+  for (int i = 0; i < n; ++i) um.emplace(keys[i], i);
+  double ui = ns_per_op(t0, n);
+
+  t0 = Clock::now();
+  for (auto k : keys) check += fm.find(k)->second;
+  double ff = ns_per_op(t0, n);
+  t0 = Clock::now();
+  for (auto k : keys) check += um.find(k)->second;
+  double uf = ns_per_op(t0, n);
+
+  t0 = Clock::now();
+  for (auto k : misses) check += fm.contains(k);
+  double fm_miss = ns_per_op(t0, n);
+  t0 = Clock::now();
+  for (auto k : misses) check += um.contains(k);
+  double um_miss = ns_per_op(t0, n);
+
+  t0 = Clock::now();
+  for (auto k : keys) check += fm.erase(k);
+  double fe = ns_per_op(t0, n);
+  t0 = Clock::now();
+  for (auto k : keys) check += um.erase(k);
+  double ue = ns_per_op(t0, n);
+
+  std::cout << "  load " << load << " (" << n << " keys): flat / unordered_map ns  insert " << fi
+            << " / " << ui << ", find " << ff << " / " << uf << ", miss " << fm_miss << " / "
+            << um_miss << ", erase " << fe << " / " << ue << "  (check " << check << ")\n";
+}
+
+int main() {
+  std::cout << "Open-addressing hash table\n";
+
+  Flat_hash_map<std::string, int> ages;
+  ages["ada"] = 36;
+  ages["alan"] = 41;
+  ages.insert("grace", 85);
+  std::string_view name = "alan";
+  std::cout << "  alan -> " << ages.find(name)->second << " (looked up by string_view)\n";
+  ages.erase("ada");
+  std::cout << "  size " << ages.size() << ", contains ada: " << ages.contains("ada") << "\n";
+
+  // enough inserts and erases to churn through tombstones and same-size rehashes
+  Flat_hash_map<int, int> churn;
+  for (int i = 0; i < 100000; ++i) {
+    churn[i] = i;
+    if (i >= 100) churn.erase(i - 100);
+  }
+  std::cout << "  after churn: size " << churn.size() << ", capacity " << churn.capacity()
+            << ", tombstones " << churn.tombstones() << "\n\n";
+
+  std::mt19937_64 gen{7};
+  const int cap = 1 << 20;
+  std::cout << "Benchmark, " << cap << " slots\n";
+  for (double load : {0.25, 0.5, 0.75, 0.875}) bench(cap, load, gen);
+
+  /*
+  Observation (one run): at load 0.25 hits cost about the same in both tables (one cache miss
+  each), but the flat table is 2-5x faster on insert and erase (no node allocation) and on misses,
+  which usually end in the first group. At 7/8 load the flat table's misses slow down as groups
+  fill up, yet still beat unordered_map, whose chains get longer too.
+  */
+
+  return 0;
+}
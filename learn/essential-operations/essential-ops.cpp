@@ -25,6 +25,8 @@ Rule of all: if you need to define one essential operation, define all.
 #include <iostream>
 #include <vector>
 
+#include "ring_tracer.h"
+
 class Vector {
  public:
   // default constructor
@@ -61,45 +63,51 @@ complex::complex(double r, double i) : re{r}, im{i} {
 struct X {
   int val;
 
-  void out(const std::string& s, int nv) {
-    std::cout << this << "->" << s << ": " << val << " (" << nv << ")" << "\n";
+  // with -DLEARN_TRACE=ON the trace goes to a binary ring buffer instead of std::cout, with val
+  // and nv packed into one record; read it back with trace-decode
+  void out(trace::Event e, int nv) {
+#if defined(LEARN_TRACE_ENABLED)
+    LEARN_TRACE(e, this, trace::pack_values(val, nv));
+#else
+    std::cout << this << "->" << trace::event_name(e) << ": " << val << " (" << nv << ")" << "\n";
+#endif
   }
 
   X() {
-    out("default constructor", 0);
+    out(trace::Event::default_ctor, 0);
     val = 0;
   };
 
   X(int x) {
-    out("constructor with int argument", x);
+    out(trace::Event::int_ctor, x);
     val = x;
   }
 
   X(const X& x) {
-    out("copy constructor", x.val);
+    out(trace::Event::copy_ctor, x.val);
     val = x.val;
   }
 
   X(X&& x) {
-    out("move constructor", x.val);
+    out(trace::Event::move_ctor, x.val);
     val = x.val;
     x.val = 0;  // leave x in a state safe for destruction
   }
 
   X& operator=(const X& x) {
-    out("copy assignment operator", x.val);
+    out(trace::Event::copy_assign, x.val);
     val = x.val;
     return *this;  // return a self-reference
   }
 
   X& operator=(X&& x) {
-    out("move assignment operator", x.val);
+    out(trace::Event::move_assign, x.val);
     val = x.val;
     x.val = 0;     // leave x in a state safe for destruction
     return *this;  // return a self-reference
   }
 
-  ~X() { out("destructor", 0); }
+  ~X() { out(trace::Event::dtor, 0); }
 };
 
 X glob{2};
@@ -1,5 +1,7 @@
 #include <iostream>
 
+#include "ring_tracer.h"
+
 class Vector {
   long int sz;   // number of elements
   double* elem;  // address of first element
@@ -76,7 +78,11 @@ Vector& Vector::operator=(const Vector& a) {
 
 // define move constructor: copy resources from arg to this object
 Vector::Vector(Vector&& arg) : sz{arg.sz}, elem{arg.elem}, space{arg.space} {
+#if defined(LEARN_TRACE_ENABLED)
+  LEARN_TRACE(trace::Event::vector_move_ctor, this, sz);
+#else
   std::cout << "Move constructor called\n";
+#endif
   // leave arg in a state that is safe for destruction
   arg.sz = 0;
   arg.elem = nullptr;
@@ -85,7 +91,11 @@ Vector::Vector(Vector&& arg) : sz{arg.sz}, elem{arg.elem}, space{arg.space} {
 
 // define move assignment operator: move arg to this object
 Vector& Vector::operator=(Vector&& arg) {
+#if defined(LEARN_TRACE_ENABLED)
+  LEARN_TRACE(trace::Event::vector_move_assign, this, arg.sz);
+#else
   std::cout << "Move assignment operator called\n";
+#endif
   // protect against self-assignment
   if (this != &arg) {
     delete[] elem;  // free old resources
@@ -96,8 +106,10 @@ Vector& Vector::operator=(Vector&& arg) {
     arg.sz = 0;
     arg.elem = nullptr;
     arg.space = 0;
+#if !defined(LEARN_TRACE_ENABLED)
     std::cout << "this address: " << this << "\n";
     std::cout << "*this address: " << &(*this) << "\n";
+#endif
   }
   return *this;  // return a self-reference
 }
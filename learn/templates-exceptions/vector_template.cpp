@@ -22,8 +22,8 @@ struct Allocator {
 
   void deallocate(T* p, int n)  // deallocate n objects of type T starting at p
   {
-    // use global operator delete
-    ::operator delete(p);
+    // use global sized operator delete: n is the count passed to allocate
+    ::operator delete(p, n * sizeof(T));
   }
 };
 
@@ -0,0 +1,91 @@
+/*
+
+Cost of one trace event
+
+Compares, per event:
+
+- synchronous text tracing, the way essential-ops.cpp's X::out did it (formatted std::ostream
+  output, here into a file so the terminal does not dominate)
+- trace::emit from include/ring_tracer.h: a timestamp and a 32-byte store into a per-thread ring
+- LEARN_TRACE with tracing compiled out (this file is built without LEARN_TRACE_ENABLED unless
+  -DLEARN_TRACE=ON), which should cost nothing
+
+Run with LEARN_TRACE_FILE=/tmp/bench.bin to keep the binary output out of the working directory.
+
+*/
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "ring_tracer.h"
+
+struct Object {
+  int val = 0;
+};
+
+template <typename F>
+double ns_per_event(int n, F f) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; ++i) f(i);
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+int main() {
+  // stay below the ring capacity per burst so nothing is dropped while measuring
+  const int n = trace::Ring::capacity / 2;
+  const int bursts = 64;
+  Object obj;
+
+  std::ofstream text{"/dev/null"};
+  double t_text = 0;
+  double t_ring = 0;
+  double t_off = 0;
+  for (int b = 0; b < bursts; ++b) {
+    t_text += ns_per_event(n, [&](int i) {
+      text << &obj << "->" << "copy constructor" << ": " << obj.val << " (" << i << ")" << "\n";
+    });
+    t_ring += ns_per_event(n, [&](int i) {
+      trace::emit(trace::Event::copy_ctor, &obj, trace::pack_values(obj.val, i));
+    });
+    t_off += ns_per_event(n, [&](int i) {
+      LEARN_TRACE(trace::Event::copy_ctor, &obj, trace::pack_values(obj.val, i));
+      obj.val += i & 1;  // something for the loop to do when the macro is empty
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});  // let the flusher catch up
+  }
+
+  std::cout << "ns per event (" << bursts << " bursts of " << n << ")\n";
+  std::cout << "  std::ostream text        " << t_text / bursts << "\n";
+  std::cout << "  ring buffer trace::emit  " << t_ring / bursts << "\n";
+#if defined(LEARN_TRACE_ENABLED)
+  std::cout << "  LEARN_TRACE (enabled)    " << t_off / bursts << "\n";
+#else
+  std::cout << "  LEARN_TRACE (disabled)   " << t_off / bursts << "\n";
+#endif
+
+  // several threads: each has its own ring, so they do not contend
+  const int n_threads = 4;
+  std::vector<std::thread> threads;
+  std::vector<double> per_thread(n_threads);
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t] {
+      Object local;
+      per_thread[t] = ns_per_event(n, [&](int i) { trace::emit(trace::Event::user, &local, i); });
+    });
+  }
+  for (auto& th : threads) th.join();
+  for (int t = 0; t < n_threads; ++t)
+    std::cout << "  thread " << t << " trace::emit     " << per_thread[t] << "\n";
+
+  /*
+  Observation (one run, VM): text 166 ns, ring 31 ns, compiled out 0.2 ns per event. Most of the
+  ring's cost is reading steady_clock; the store itself is a few ns. Threads do not slow each
+  other down beyond sharing the core.
+  */
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Offline decoder for the binary files written by include/ring_tracer.h
+//
+//   trace-decode [file]   (default: learn-trace.bin)
+//
+// Prints one line per event, sorted by time, in the same shape as the std::cout tracing:
+//   +<ns since first event> [thread] <object address>-><event name>: <value> (<new value>)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "ring_tracer.h"
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "learn-trace.bin";
+  std::FILE* f = std::fopen(path, "rb");
+  if (!f) {
+    std::cerr << "cannot open " << path << "\n";
+    return 1;
+  }
+
+  trace::File_header h;
+  const trace::File_header expected;
+  if (std::fread(&h, sizeof h, 1, f) != 1 || std::memcmp(h.magic, expected.magic, 4) != 0 ||
+      h.version != expected.version || h.record_size != sizeof(trace::Record)) {
+    std::cerr << path << " is not a version " << expected.version << " trace file\n";
+    std::fclose(f);
+    return 1;
+  }
+
+  std::vector<trace::Record> records;
+  trace::Record r;
+  while (std::fread(&r, sizeof r, 1, f) == 1) records.push_back(r);
+  std::fclose(f);
+
+  // each ring is flushed in order, but rings of different threads interleave in the file
+  auto by_time = [](const trace::Record& a, const trace::Record& b) { return a.ts_ns < b.ts_ns; };
+  std::stable_sort(records.begin(), records.end(), by_time);
+
+  std::uint64_t t0 = records.empty() ? 0 : records.front().ts_ns;
+  std::uint64_t dropped = 0;
+  for (const trace::Record& e : records) {
+    auto id = static_cast<trace::Event>(e.id);
+    if (id == trace::Event::dropped) dropped += e.value;
+    std::cout << "+" << e.ts_ns - t0 << " [" << e.thread << "] "
+              << reinterpret_cast<const void*>(e.object) << "->" << trace::event_name(id) << ": ";
+    if (trace::has_value_pair(id))
+      std::cout << trace::current_value(e.value) << " (" << trace::next_value(e.value) << ")\n";
+    else
+      std::cout << e.value << "\n";
+  }
+
+  std::cerr << records.size() << " records";
+  if (dropped) std::cerr << ", " << dropped << " events dropped (ring full)";
+  std::cerr << "\n";
+  return 0;
+}